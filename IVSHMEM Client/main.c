@@ -20,9 +20,11 @@
 #include <CoreFoundation/CoreFoundation.h>
 
 #include "IVSHMEMShared.hpp"
+#include "IVSHMEMLanes.hpp"
 
 void TestUserClient( io_service_t service );
 void TestSharedMemory( io_connect_t connect );
+kern_return_t SignalLane( io_connect_t connect, const IVSHMEMChannelView *view, uint32_t lane, uint16_t peer );
 
 #define arrayCnt(var) (sizeof(var) / sizeof(var[0]))
 
@@ -124,6 +126,16 @@ void TestSharedMemory( io_connect_t connect )
     
     strcpy( shared->string, "some other data" );
 }
+
+// After IVSHMEMLaneSend(), ring the peer's doorbell on the lane's own vector so
+// latency lanes can be signalled separately from bulk traffic.
+kern_return_t SignalLane( io_connect_t connect, const IVSHMEMChannelView *view, uint32_t lane, uint16_t peer )
+{
+    uint64_t    input[2] = { peer, IVSHMEMLaneVector( view, lane ) };
+    
+    return IOConnectCallScalarMethod( connect, kSampleMethod3, input, arrayCnt(input), NULL, NULL );
+}
+
 int main(int argc, const char * argv[]) {
     // insert code here...
     printf("Hello, World!\n");
@@ -8,6 +8,7 @@
 #include "IVSHMEM.hpp"
 #include <IOKit/IOLib.h>
 #include <IOKit/assert.h>
+#include <libkern/OSByteOrder.h>
 
 // This required macro defines the class's constructors, destructors, and several other methods I/O Kit requires.
 OSDefineMetaClassAndStructors(IVSHMEMDevice, IOService)
@@ -86,7 +87,7 @@ bool IVSHMEMDevice::start(IOService *provider)
     /* Map a range based on its config space base address register,
      * This is how the driver gets access to its memory-mapped registers.
      * The getVirtualAddress() method returns a kernel virtual address
-     * for the register mapping */
+     * for the register mapping. We keep it for the doorbell. */
     
     map = fPCIDevice->mapDeviceMemoryWithRegister(
                                                   kIOPCIConfigBaseAddress0 );
@@ -96,10 +97,8 @@ bool IVSHMEMDevice::start(IOService *provider)
               map->getPhysicalAddress(),
               map->getVirtualAddress()
               );
-        
-        /* Release the map object, and the mapping itself */
-        map->release();
     }
+    fRegisterMap = map;
     
     /* Read a config space register */
     IOLog("Config register@0x%x = " UInt32_FORMAT "\n", kIOPCIConfigCommand,
@@ -139,6 +138,13 @@ void IVSHMEMDevice::stop(IOService *provider)
 {
     IOLog("Stopping...\n");
     IOLog("%s[%p]::%s(%p)\n", getName(), this, __FUNCTION__, provider);
+    
+    /* Release the map object, and the mapping itself */
+    if (fRegisterMap) {
+        fRegisterMap->release();
+        fRegisterMap = 0;
+    }
+    
     super::stop(provider);
 }
 
@@ -158,3 +164,20 @@ IOMemoryDescriptor * IVSHMEMDevice::copyGlobalMemory(void)
     
     return memory;
 }
+
+/*
+ * Ring the doorbell of another peer on one of its interrupt vectors. Clients
+ * reach this through the user client rather than mapping BAR0 themselves,
+ * so they can't touch the interrupt mask or status registers.
+ */
+
+IOReturn IVSHMEMDevice::ringDoorbell(UInt16 peer, UInt16 vector)
+{
+    if (!fRegisterMap)
+        return kIOReturnNotReady;
+    
+    /* BAR0 is memory-mapped, so write through the mapping rather than ioWrite32(), which is port I/O */
+    OSWriteLittleInt32((void *) fRegisterMap->getVirtualAddress(), Doorbell, ((UInt32) peer << 16) | vector);
+    
+    return kIOReturnSuccess;
+}
@@ -12,6 +12,7 @@
 // Forward declarations
 class IOPCIDevice;
 class IOMemoryDescriptor;
+class IOMemoryMap;
 
 class IVSHMEMDevice : public IOService {
     
@@ -19,6 +20,7 @@ class IVSHMEMDevice : public IOService {
 
 private:
     IOPCIDevice             *fPCIDevice;
+    IOMemoryMap             *fRegisterMap;
 //    IOMemoryDescriptor      *fLowMemory;
     
 public:
@@ -32,6 +34,7 @@ public:
     
     // Other methods
     IOMemoryDescriptor* copyGlobalMemory(void);
+    IOReturn ringDoorbell(UInt16 peer, UInt16 vector);
 //    IOReturn generateDMAAddresses(IOMemoryDescriptor *memDesc);
 //    void updateRegistry(UInt32 value);
 };
@@ -0,0 +1,420 @@
+//
+//  IVSHMEMChecksum.hpp
+//  IVSHMEM
+//
+//  Copyright © 2020 Ali. All rights reserved.
+//
+
+#ifndef IVSHMEMChecksum_hpp
+#define IVSHMEMChecksum_hpp
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Records are the unit of data exchanged through BAR2. Each record is a
+// header followed by `length` payload bytes. The producer may stamp the
+// record with a CRC32C; the consumer only checks it when it asks to, so
+// unverified records cost nothing beyond the copy.
+enum {
+    kIVSHMEMRecordStamped   = 1 << 0,   // crc holds the CRC32C of the payload and header
+};
+
+// Options for IVSHMEMRecordRead().
+enum {
+    kIVSHMEMVerifyPayload       = 1 << 0,   // check the CRC while copying out
+    kIVSHMEMVerifyRequireStamp  = 1 << 1,   // treat unstamped records as corrupt
+};
+
+typedef struct IVSHMEMRecordHeader {
+    uint32_t    length;     // payload bytes following the header
+    uint32_t    flags;
+    uint32_t    sequence;   // producer-assigned, used for sampled verification
+    uint32_t    crc;
+} IVSHMEMRecordHeader;
+
+#define kIVSHMEMCRC32CInit      0xFFFFFFFFu
+#define kIVSHMEMCRC32CPoly      0x82F63B78u     // Castagnoli, reflected
+
+/*
+ * CRC32C primitives. The SSE4.2 crc32 instruction (and its ARMv8 equivalent)
+ * only touches general purpose registers, so it is safe to use in the kext
+ * as well as in userland without saving any vector state.
+ *
+ * The default x86_64 macOS target doesn't enable SSE4.2, so on x86_64 the
+ * hardware kernels are compiled with a target attribute and picked at run
+ * time from CPUID. arm64 macOS always targets a CPU with the CRC32 extension.
+ */
+
+static inline uint32_t IVSHMEMCRC32CByteSoftware(uint32_t crc, uint8_t byte)
+{
+    crc ^= byte;
+    for (int bit = 0; bit < 8; bit++)
+        crc = (crc >> 1) ^ (kIVSHMEMCRC32CPoly & (0u - (crc & 1)));
+    return crc;
+}
+
+static inline uint32_t IVSHMEMCRC32CWordSoftware(uint32_t crc, uint64_t word)
+{
+    for (int i = 0; i < 8; i++) {
+        crc = IVSHMEMCRC32CByteSoftware(crc, (uint8_t) word);
+        word >>= 8;
+    }
+    return crc;
+}
+
+/*
+ * A single crc32 dependency chain runs at a third of the instruction's
+ * throughput. Buffers are therefore cut into blocks of three equal streams
+ * that are checksummed side by side and then stitched together: appending
+ * n bytes to a CRC multiplies it by x^(8n). Three block sizes keep the
+ * streams busy from bulk payloads down to the small records lanes carry;
+ * only the last 191 bytes or less run on a single chain.
+ */
+#define kIVSHMEMCRC32CStrideLarge       2048
+#define kIVSHMEMCRC32CStrideMedium      256
+#define kIVSHMEMCRC32CStrideSmall       64
+
+#define kIVSHMEMCRC32CShiftLarge        0x0D65762Au     // x^(8 * kIVSHMEMCRC32CStrideLarge) mod P
+#define kIVSHMEMCRC32CShiftMedium       0x88E56F72u     // x^(8 * kIVSHMEMCRC32CStrideMedium) mod P
+#define kIVSHMEMCRC32CShiftSmall        0xB82BE955u     // x^(8 * kIVSHMEMCRC32CStrideSmall) mod P
+
+// a * b modulo the CRC32C polynomial, both in reflected form.
+static inline uint32_t IVSHMEMCRC32CMultiply(uint32_t a, uint32_t b)
+{
+    uint32_t product = 0;
+
+    for (uint32_t m = 1u << 31; m; m >>= 1) {
+        if (a & m)
+            product ^= b;
+        b = (b >> 1) ^ (kIVSHMEMCRC32CPoly & (0u - (b & 1)));
+    }
+
+    return product;
+}
+
+/*
+ * The bit-serial multiply above would cost more than a small block saves,
+ * so the stitching uses these instead: entry [tier][k][n] is
+ * IVSHMEMCRC32CMultiply(kIVSHMEMCRC32CShift<tier>, n << 4k), and a product
+ * is the XOR of one entry per nibble of the CRC. They are constants so the
+ * kext needs no initialisation; checksum_test regenerates and compares them.
+ */
+enum {
+    kIVSHMEMCRC32CTierLarge     = 0,
+    kIVSHMEMCRC32CTierMedium    = 1,
+    kIVSHMEMCRC32CTierSmall     = 2,
+};
+
+static const uint32_t kIVSHMEMCRC32CShiftTables[3][8][16] = {
+    {   // x^(8 * 2048)
+        { 0x00000000, 0xF7506984, 0xEB4CA5F9, 0x1C1CCC7D, 0xD3753D03, 0x24255487, 0x383998FA, 0xCF69F17E,
+          0xA3060CF7, 0x54566573, 0x484AA90E, 0xBF1AC08A, 0x707331F4, 0x87235870, 0x9B3F940D, 0x6C6FFD89 },
+        { 0x00000000, 0x43E06F1F, 0x87C0DE3E, 0xC420B121, 0x0A6DCA8D, 0x498DA592, 0x8DAD14B3, 0xCE4D7BAC,
+          0x14DB951A, 0x573BFA05, 0x931B4B24, 0xD0FB243B, 0x1EB65F97, 0x5D563088, 0x997681A9, 0xDA96EEB6 },
+        { 0x00000000, 0x29B72A34, 0x536E5468, 0x7AD97E5C, 0xA6DCA8D0, 0x8F6B82E4, 0xF5B2FCB8, 0xDC05D68C,
+          0x48552751, 0x61E20D65, 0x1B3B7339, 0x328C590D, 0xEE898F81, 0xC73EA5B5, 0xBDE7DBE9, 0x9450F1DD },
+        { 0x00000000, 0x90AA4EA2, 0x24B8EBB5, 0xB412A517, 0x4971D76A, 0xD9DB99C8, 0x6DC93CDF, 0xFD63727D,
+          0x92E3AED4, 0x0249E076, 0xB65B4561, 0x26F10BC3, 0xDB9279BE, 0x4B38371C, 0xFF2A920B, 0x6F80DCA9 },
+        { 0x00000000, 0x202B2B59, 0x405656B2, 0x607D7DEB, 0x80ACAD64, 0xA087863D, 0xC0FAFBD6, 0xE0D1D08F,
+          0x04B52C39, 0x249E0760, 0x44E37A8B, 0x64C851D2, 0x8419815D, 0xA432AA04, 0xC44FD7EF, 0xE464FCB6 },
+        { 0x00000000, 0x096A5872, 0x12D4B0E4, 0x1BBEE896, 0x25A961C8, 0x2CC339BA, 0x377DD12C, 0x3E17895E,
+          0x4B52C390, 0x42389BE2, 0x59867374, 0x50EC2B06, 0x6EFBA258, 0x6791FA2A, 0x7C2F12BC, 0x75454ACE },
+        { 0x00000000, 0x96A58720, 0x28A778B1, 0xBE02FF91, 0x514EF162, 0xC7EB7642, 0x79E989D3, 0xEF4C0EF3,
+          0xA29DE2C4, 0x343865E4, 0x8A3A9A75, 0x1C9F1D55, 0xF3D313A6, 0x65769486, 0xDB746B17, 0x4DD1EC37 },
+        { 0x00000000, 0x40D7B379, 0x81AF66F2, 0xC178D58B, 0x06B2BB15, 0x4665086C, 0x871DDDE7, 0xC7CA6E9E,
+          0x0D65762A, 0x4DB2C553, 0x8CCA10D8, 0xCC1DA3A1, 0x0BD7CD3F, 0x4B007E46, 0x8A78ABCD, 0xCAAF18B4 },
+    },
+    {   // x^(8 * 256)
+        { 0x00000000, 0xDCB17AA4, 0xBC8E83B9, 0x603FF91D, 0x7CF17183, 0xA0400B27, 0xC07FF23A, 0x1CCE889E,
+          0xF9E2E306, 0x255399A2, 0x456C60BF, 0x99DD1A1B, 0x85139285, 0x59A2E821, 0x399D113C, 0xE52C6B98 },
+        { 0x00000000, 0xF629B0FD, 0xE9BF170B, 0x1F96A7F6, 0xD69258E7, 0x20BBE81A, 0x3F2D4FEC, 0xC904FF11,
+          0xA8C8C73F, 0x5EE177C2, 0x4177D034, 0xB75E60C9, 0x7E5A9FD8, 0x88732F25, 0x97E588D3, 0x61CC382E },
+        { 0x00000000, 0x547DF88F, 0xA8FBF11E, 0xFC860991, 0x541B94CD, 0x00666C42, 0xFCE065D3, 0xA89D9D5C,
+          0xA837299A, 0xFC4AD115, 0x00CCD884, 0x54B1200B, 0xFC2CBD57, 0xA85145D8, 0x54D74C49, 0x00AAB4C6 },
+        { 0x00000000, 0x558225C5, 0xAB044B8A, 0xFE866E4F, 0x53E4E1E5, 0x0666C420, 0xF8E0AA6F, 0xAD628FAA,
+          0xA7C9C3CA, 0xF24BE60F, 0x0CCD8840, 0x594FAD85, 0xF42D222F, 0xA1AF07EA, 0x5F2969A5, 0x0AAB4C60 },
+        { 0x00000000, 0x4A7FF165, 0x94FFE2CA, 0xDE8013AF, 0x2C13B365, 0x666C4200, 0xB8EC51AF, 0xF293A0CA,
+          0x582766CA, 0x125897AF, 0xCCD88400, 0x86A77565, 0x7434D5AF, 0x3E4B24CA, 0xE0CB3765, 0xAAB4C600 },
+        { 0x00000000, 0xB04ECD94, 0x6571EDD9, 0xD53F204D, 0xCAE3DBB2, 0x7AAD1626, 0xAF92366B, 0x1FDCFBFF,
+          0x902BC195, 0x20650C01, 0xF55A2C4C, 0x4514E1D8, 0x5AC81A27, 0xEA86D7B3, 0x3FB9F7FE, 0x8FF73A6A },
+        { 0x00000000, 0x25BBF5DB, 0x4B77EBB6, 0x6ECC1E6D, 0x96EFD76C, 0xB35422B7, 0xDD983CDA, 0xF823C901,
+          0x2833D829, 0x0D882DF2, 0x6344339F, 0x46FFC644, 0xBEDC0F45, 0x9B67FA9E, 0xF5ABE4F3, 0xD0101128 },
+        { 0x00000000, 0x5067B052, 0xA0CF60A4, 0xF0A8D0F6, 0x4472B7B9, 0x141507EB, 0xE4BDD71D, 0xB4DA674F,
+          0x88E56F72, 0xD882DF20, 0x282A0FD6, 0x784DBF84, 0xCC97D8CB, 0x9CF06899, 0x6C58B86F, 0x3C3F083D },
+    },
+    {   // x^(8 * 64)
+        { 0x00000000, 0x740EEF02, 0xE81DDE04, 0x9C133106, 0xD5D7CAF9, 0xA1D925FB, 0x3DCA14FD, 0x49C4FBFF,
+          0xAE43E303, 0xDA4D0C01, 0x465E3D07, 0x3250D205, 0x7B9429FA, 0x0F9AC6F8, 0x9389F7FE, 0xE78718FC },
+        { 0x00000000, 0x596BB0F7, 0xB2D761EE, 0xEBBCD119, 0x6042B52D, 0x392905DA, 0xD295D4C3, 0x8BFE6434,
+          0xC0856A5A, 0x99EEDAAD, 0x72520BB4, 0x2B39BB43, 0xA0C7DF77, 0xF9AC6F80, 0x1210BE99, 0x4B7B0E6E },
+        { 0x00000000, 0x84E6A245, 0x0C21327B, 0x88C7903E, 0x184264F6, 0x9CA4C6B3, 0x1463568D, 0x9085F4C8,
+          0x3084C9EC, 0xB4626BA9, 0x3CA5FB97, 0xB84359D2, 0x28C6AD1A, 0xAC200F5F, 0x24E79F61, 0xA0013D24 },
+        { 0x00000000, 0x610993D8, 0xC21327B0, 0xA31AB468, 0x81CA3991, 0xE0C3AA49, 0x43D91E21, 0x22D08DF9,
+          0x067805D3, 0x6771960B, 0xC46B2263, 0xA562B1BB, 0x87B23C42, 0xE6BBAF9A, 0x45A11BF2, 0x24A8882A },
+        { 0x00000000, 0x0CF00BA6, 0x19E0174C, 0x15101CEA, 0x33C02E98, 0x3F30253E, 0x2A2039D4, 0x26D03272,
+          0x67805D30, 0x6B705696, 0x7E604A7C, 0x729041DA, 0x544073A8, 0x58B0780E, 0x4DA064E4, 0x41506F42 },
+        { 0x00000000, 0xCF00BA60, 0x9BED0231, 0x54EDB851, 0x32367293, 0xFD36C8F3, 0xA9DB70A2, 0x66DBCAC2,
+          0x646CE526, 0xAB6C5F46, 0xFF81E717, 0x30815D77, 0x565A97B5, 0x995A2DD5, 0xCDB79584, 0x02B72FE4 },
+        { 0x00000000, 0xC8D9CA4C, 0x945FE269, 0x5C862825, 0x2D53B223, 0xE58A786F, 0xB90C504A, 0x71D59A06,
+          0x5AA76446, 0x927EAE0A, 0xCEF8862F, 0x06214C63, 0x77F4D665, 0xBF2D1C29, 0xE3AB340C, 0x2B72FE40 },
+        { 0x00000000, 0xB54EC88C, 0x6F71E7E9, 0xDA3F2F65, 0xDEE3CFD2, 0x6BAD075E, 0xB192283B, 0x04DCE0B7,
+          0xB82BE955, 0x0D6521D9, 0xD75A0EBC, 0x6214C630, 0x66C82687, 0xD386EE0B, 0x09B9C16E, 0xBCF709E2 },
+    },
+};
+
+// crc * x^(8 * stride of `tier`), i.e. crc followed by that many zero bytes.
+static inline uint32_t IVSHMEMCRC32CShift(uint32_t tier, uint32_t crc)
+{
+    const uint32_t (*table)[16] = kIVSHMEMCRC32CShiftTables[tier];
+    uint32_t result = 0;
+
+    for (int k = 0; k < 8; k++, crc >>= 4)
+        result ^= table[k][crc & 15];
+
+    return result;
+}
+
+// Checksum as many blocks of three `stride`-byte streams as fit, storing
+// each word to the destination as well if the kernel copies. The streams
+// are kept in 64-bit registers: on x86_64 narrowing crc32q's result after
+// every step would put an extra move on each dependency chain.
+#define IVSHMEM_CRC32C_BLOCKS(stride, tier, WORD, STORE)                                        \
+    for (; length - done >= 3 * (stride); done += 3 * (stride)) {                               \
+        uint64_t crc0 = crc, crc1 = 0, crc2 = 0;                                                \
+                                                                                                \
+        for (size_t i = done; i < done + (stride); i += sizeof(word)) {                         \
+            memcpy(&word, s + i, sizeof(word));                                                 \
+            memcpy(&word1, s + (stride) + i, sizeof(word));                                     \
+            memcpy(&word2, s + 2 * (stride) + i, sizeof(word));                                 \
+            crc0 = WORD(crc0, word);                                                            \
+            crc1 = WORD(crc1, word1);                                                           \
+            crc2 = WORD(crc2, word2);                                                           \
+            STORE(i, word);                                                                     \
+            STORE((stride) + i, word1);                                                         \
+            STORE(2 * (stride) + i, word2);                                                     \
+        }                                                                                       \
+        crc = IVSHMEMCRC32CShift(tier, (uint32_t) crc0) ^ (uint32_t) crc1;                      \
+        crc = IVSHMEMCRC32CShift(tier, crc) ^ (uint32_t) crc2;                                  \
+    }
+
+#define IVSHMEM_CRC32C_BODY(BYTE, WORD, STORE)                                                  \
+    uint64_t word, word1, word2;                                                                \
+    size_t done = 0;                                                                            \
+                                                                                                \
+    IVSHMEM_CRC32C_BLOCKS(kIVSHMEMCRC32CStrideLarge, kIVSHMEMCRC32CTierLarge, WORD, STORE)      \
+    IVSHMEM_CRC32C_BLOCKS(kIVSHMEMCRC32CStrideMedium, kIVSHMEMCRC32CTierMedium, WORD, STORE)    \
+    IVSHMEM_CRC32C_BLOCKS(kIVSHMEMCRC32CStrideSmall, kIVSHMEMCRC32CTierSmall, WORD, STORE)      \
+                                                                                                \
+    for (; length - done >= sizeof(word); done += sizeof(word)) {                               \
+        memcpy(&word, s + done, sizeof(word));                                                  \
+        crc = WORD(crc, word);                                                                  \
+        STORE(done, word);                                                                      \
+    }                                                                                           \
+    for (; done < length; done++) {                                                             \
+        crc = BYTE(crc, s[done]);                                                               \
+        STORE(done, s[done]);                                                                   \
+    }                                                                                           \
+                                                                                                \
+    return crc;
+
+#define IVSHMEM_CRC32C_STORE_NONE(offset, value)    ((void) 0)
+#define IVSHMEM_CRC32C_STORE_COPY(offset, value)    memcpy(d + (offset), &(value), sizeof(value))
+
+// Defines IVSHMEMCRC32CUpdate<suffix>() and IVSHMEMCopyWithCRC32CUpdate<suffix>()
+// around a pair of byte/word primitives. Both continue a running CRC.
+#define IVSHMEM_CRC32C_KERNELS(suffix, attributes, BYTE, WORD)                                  \
+attributes static inline uint32_t IVSHMEMCRC32CUpdate##suffix(uint32_t crc, const void *data,   \
+                                                              size_t length)                    \
+{                                                                                               \
+    const uint8_t *s = (const uint8_t *) data;                                                  \
+                                                                                                \
+    IVSHMEM_CRC32C_BODY(BYTE, WORD, IVSHMEM_CRC32C_STORE_NONE)                                  \
+}                                                                                               \
+                                                                                                \
+attributes static inline uint32_t IVSHMEMCopyWithCRC32CUpdate##suffix(uint32_t crc, void *dst,  \
+                                                                      const void *src,          \
+                                                                      size_t length)            \
+{                                                                                               \
+    uint8_t *d = (uint8_t *) dst;                                                               \
+    const uint8_t *s = (const uint8_t *) src;                                                   \
+                                                                                                \
+    IVSHMEM_CRC32C_BODY(BYTE, WORD, IVSHMEM_CRC32C_STORE_COPY)                                  \
+}
+
+IVSHMEM_CRC32C_KERNELS(Software, , IVSHMEMCRC32CByteSoftware, IVSHMEMCRC32CWordSoftware)
+
+#if defined(__x86_64__)
+
+#define IVSHMEMCRC32CByteSSE42(crc, byte)   __builtin_ia32_crc32qi((crc), (byte))
+#define IVSHMEMCRC32CWordSSE42(crc, word)   __builtin_ia32_crc32di((crc), (word))
+
+IVSHMEM_CRC32C_KERNELS(SSE42, __attribute__((target("sse4.2"))),
+                       IVSHMEMCRC32CByteSSE42, IVSHMEMCRC32CWordSSE42)
+
+// CPUID.1:ECX bit 20. Cached per translation unit; racing callers store the same value.
+static inline bool IVSHMEMHasSSE42(void)
+{
+    static int cached = -1;
+    int value = __atomic_load_n(&cached, __ATOMIC_RELAXED);
+
+    if (value < 0) {
+        uint32_t eax = 1, ebx, ecx = 0, edx;
+
+        __asm__ ("cpuid" : "+a" (eax), "=b" (ebx), "+c" (ecx), "=d" (edx));
+        value = (ecx >> 20) & 1;
+        __atomic_store_n(&cached, value, __ATOMIC_RELAXED);
+    }
+
+    return value != 0;
+}
+
+#define IVSHMEM_CRC32C_DISPATCH(function, ...) \
+    (IVSHMEMHasSSE42() ? function##SSE42(__VA_ARGS__) : function##Software(__VA_ARGS__))
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+
+#define IVSHMEMCRC32CByteARMv8(crc, byte)   __builtin_arm_crc32cb((crc), (byte))
+#define IVSHMEMCRC32CWordARMv8(crc, word)   __builtin_arm_crc32cd((crc), (word))
+
+IVSHMEM_CRC32C_KERNELS(ARMv8, , IVSHMEMCRC32CByteARMv8, IVSHMEMCRC32CWordARMv8)
+
+#define IVSHMEM_CRC32C_DISPATCH(function, ...)  function##ARMv8(__VA_ARGS__)
+
+#else
+
+#define IVSHMEM_CRC32C_DISPATCH(function, ...)  function##Software(__VA_ARGS__)
+
+#endif
+
+// Continue a running CRC32C over `length` bytes. Start from kIVSHMEMCRC32CInit
+// and invert the final value, or use IVSHMEMCRC32C() for a one-shot checksum.
+static inline uint32_t IVSHMEMCRC32CUpdate(uint32_t crc, const void *data, size_t length)
+{
+    return IVSHMEM_CRC32C_DISPATCH(IVSHMEMCRC32CUpdate, crc, data, length);
+}
+
+static inline uint32_t IVSHMEMCRC32C(const void *data, size_t length)
+{
+    return ~IVSHMEMCRC32CUpdate(kIVSHMEMCRC32CInit, data, length);
+}
+
+// Copy `length` bytes and continue a running CRC32C over them in the same
+// pass, so every byte of the source is read exactly once.
+static inline uint32_t IVSHMEMCopyWithCRC32CUpdate(uint32_t crc, void *dst, const void *src, size_t length)
+{
+    return IVSHMEM_CRC32C_DISPATCH(IVSHMEMCopyWithCRC32CUpdate, crc, dst, src, length);
+}
+
+static inline uint32_t IVSHMEMCopyWithCRC32C(void *dst, const void *src, size_t length)
+{
+    return ~IVSHMEMCopyWithCRC32CUpdate(kIVSHMEMCRC32CInit, dst, src, length);
+}
+
+// Fold the header fields into a running payload CRC and finish it, so a
+// flipped bit in the length, flags or sequence fails verification too.
+static inline uint32_t IVSHMEMRecordSeal(uint32_t crc, uint32_t length, uint32_t flags, uint32_t sequence)
+{
+    uint32_t fields[3] = { length, flags, sequence };
+
+    return ~IVSHMEMCRC32CUpdate(crc, fields, sizeof(fields));
+}
+
+/*
+ * Producer side: fill in the header and copy the payload in behind it.
+ * `record` must have room for sizeof(IVSHMEMRecordHeader) + length bytes.
+ */
+static inline void IVSHMEMRecordWrite(IVSHMEMRecordHeader *record, uint32_t sequence,
+                                      const void *payload, uint32_t length, bool stamp)
+{
+    record->length   = length;
+    record->sequence = sequence;
+
+    if (stamp) {
+        uint32_t crc = IVSHMEMCopyWithCRC32CUpdate(kIVSHMEMCRC32CInit, record + 1, payload, length);
+
+        record->flags = kIVSHMEMRecordStamped;
+        record->crc   = IVSHMEMRecordSeal(crc, length, kIVSHMEMRecordStamped, sequence);
+    } else {
+        memcpy(record + 1, payload, length);
+        record->flags = 0;
+        record->crc   = 0;
+    }
+}
+
+/*
+ * Consumer side. Verification is lazy: nothing is checked unless the
+ * consumer calls IVSHMEMRecordVerify() or IVSHMEMRecordRead() with
+ * kIVSHMEMVerifyPayload. Unstamped records verify unless the consumer
+ * requires stamps, which it should whenever the producer always stamps.
+ *
+ * The header is owned by the peer, so each field is read exactly once and
+ * `length` is checked against `available`, the bytes the caller knows lie
+ * behind the header, before anything is touched.
+ */
+
+static inline void IVSHMEMRecordSnapshot(const IVSHMEMRecordHeader *record, IVSHMEMRecordHeader *snapshot)
+{
+    snapshot->length   = __atomic_load_n(&record->length, __ATOMIC_RELAXED);
+    snapshot->flags    = __atomic_load_n(&record->flags, __ATOMIC_RELAXED);
+    snapshot->sequence = __atomic_load_n(&record->sequence, __ATOMIC_RELAXED);
+    snapshot->crc      = __atomic_load_n(&record->crc, __ATOMIC_RELAXED);
+}
+
+// True for one record in every 2^sampleShift. sampleShift is clamped to 31.
+static inline bool IVSHMEMRecordSampled(const IVSHMEMRecordHeader *record, uint32_t sampleShift)
+{
+    if (sampleShift > 31)
+        sampleShift = 31;
+
+    return (__atomic_load_n(&record->sequence, __ATOMIC_RELAXED) & ((1u << sampleShift) - 1)) == 0;
+}
+
+static inline bool IVSHMEMRecordVerify(const IVSHMEMRecordHeader *record, size_t available, bool requireStamp)
+{
+    IVSHMEMRecordHeader h;
+    uint32_t crc;
+
+    IVSHMEMRecordSnapshot(record, &h);
+    if (h.length > available)
+        return false;
+    if (!(h.flags & kIVSHMEMRecordStamped))
+        return !requireStamp;
+
+    crc = IVSHMEMCRC32CUpdate(kIVSHMEMCRC32CInit, record + 1, h.length);
+    return IVSHMEMRecordSeal(crc, h.length, h.flags, h.sequence) == h.crc;
+}
+
+// Copy the payload out, verifying it in the same pass when asked to. On
+// success `*lengthOut` holds the number of bytes written to `dst`.
+static inline bool IVSHMEMRecordRead(const IVSHMEMRecordHeader *record, size_t available,
+                                     void *dst, size_t dstCapacity, uint32_t *lengthOut,
+                                     uint32_t options)
+{
+    IVSHMEMRecordHeader h;
+    uint32_t crc;
+
+    IVSHMEMRecordSnapshot(record, &h);
+    if (h.length > available || h.length > dstCapacity)
+        return false;
+
+    *lengthOut = h.length;
+
+    if (!(h.flags & kIVSHMEMRecordStamped)) {
+        if (options & kIVSHMEMVerifyRequireStamp)
+            return false;
+        memcpy(dst, record + 1, h.length);
+        return true;
+    }
+
+    if (!(options & kIVSHMEMVerifyPayload)) {
+        memcpy(dst, record + 1, h.length);
+        return true;
+    }
+
+    crc = IVSHMEMCopyWithCRC32CUpdate(kIVSHMEMCRC32CInit, dst, record + 1, h.length);
+    return IVSHMEMRecordSeal(crc, h.length, h.flags, h.sequence) == h.crc;
+}
+
+#endif /* IVSHMEMChecksum_hpp */
@@ -0,0 +1,448 @@
+//
+//  IVSHMEMLanes.hpp
+//  IVSHMEM
+//
+//  Copyright © 2020 Ali. All rights reserved.
+//
+
+#ifndef IVSHMEMLanes_hpp
+#define IVSHMEMLanes_hpp
+
+#include "IVSHMEMChecksum.hpp"
+
+/*
+ * Priority lanes over the BAR2 region. A channel header at the start of the
+ * region describes up to kIVSHMEMMaxLanes single-producer/single-consumer
+ * rings. Each lane has a class and its own doorbell vector, so small
+ * latency-sensitive messages are never queued behind bulk transfers and
+ * can be signalled separately (kSampleMethod3 on the user client).
+ *
+ * Lane index is priority: lower indices are drained first within a class.
+ */
+
+#define kIVSHMEMChannelMagic        0x4C4E4853u     // 'SHNL'
+#define kIVSHMEMMaxLanes            8
+#define kIVSHMEMLaneAlignment       8
+#define kIVSHMEMLaneWrap            0xFFFFFFFFu     // record length marking a skip to the ring start
+#define kIVSHMEMDefaultQuantum      4096
+
+enum {
+    kIVSHMEMLaneLatency     = 0,    // strict priority, always drained first
+    kIVSHMEMLaneBulk        = 1,    // shared by deficit round-robin
+};
+
+// Head and tail live on separate cache lines so the two sides don't
+// bounce a line between them on every message.
+typedef struct IVSHMEMLane {
+    uint32_t            offset;     // ring start, relative to the channel header
+    uint32_t            size;       // ring bytes, a power of two
+    uint32_t            laneClass;
+    uint32_t            vector;     // doorbell vector used to signal this lane
+    uint32_t            quantum;    // deficit round-robin quantum in bytes (bulk lanes)
+    uint32_t            reserved0[11];
+    volatile uint32_t   head;       // bytes produced, written by the producer only
+    uint32_t            sequence;   // next record sequence, producer only
+    uint32_t            reserved1[14];
+    volatile uint32_t   tail;       // bytes consumed, written by the consumer only
+    uint32_t            reserved2[15];
+} IVSHMEMLane;
+
+typedef struct IVSHMEMChannel {
+    volatile uint32_t   magic;      // written last by IVSHMEMChannelFormat()
+    uint32_t            laneCount;
+    uint32_t            reserved[14];
+    IVSHMEMLane         lanes[kIVSHMEMMaxLanes];
+} IVSHMEMChannel;
+
+// What sits in a lane ring: an optional deadline followed by a record.
+typedef struct IVSHMEMLaneMessage {
+    uint64_t            deadline;   // 0 for none, otherwise in the caller's timebase
+    IVSHMEMRecordHeader record;
+} IVSHMEMLaneMessage;
+
+typedef struct IVSHMEMLaneConfig {
+    uint32_t    laneClass;
+    uint32_t    vector;
+    uint32_t    size;               // ring bytes, a power of two
+    uint32_t    quantum;            // 0 selects kIVSHMEMDefaultQuantum
+} IVSHMEMLaneConfig;
+
+/*
+ * Everything in IVSHMEMChannel is writable by the peer. Each side therefore
+ * works from a private, validated snapshot of the layout taken when it
+ * formats or attaches, and only head, tail and the messages themselves are
+ * read from BAR2 afterwards.
+ */
+typedef struct IVSHMEMLaneInfo {
+    uint32_t    offset;
+    uint32_t    size;
+    uint32_t    laneClass;
+    uint32_t    vector;
+    uint32_t    quantum;            // never 0
+} IVSHMEMLaneInfo;
+
+typedef struct IVSHMEMChannelView {
+    IVSHMEMChannel      *channel;
+    uint32_t            laneCount;
+    IVSHMEMLaneInfo     lanes[kIVSHMEMMaxLanes];
+} IVSHMEMChannelView;
+
+// A message the consumer has validated, with the fields it depends on copied out.
+typedef struct IVSHMEMLaneSlot {
+    const IVSHMEMLaneMessage    *message;
+    uint32_t                    size;       // ring bytes the message occupies
+    uint32_t                    length;     // payload bytes, at most size - sizeof(IVSHMEMLaneMessage)
+    uint64_t                    deadline;
+} IVSHMEMLaneSlot;
+
+static inline uint32_t IVSHMEMLaneMessageSize(uint32_t length)
+{
+    return ((uint32_t) sizeof(IVSHMEMLaneMessage) + length + (kIVSHMEMLaneAlignment - 1))
+           & ~(uint32_t) (kIVSHMEMLaneAlignment - 1);
+}
+
+static inline uint8_t *IVSHMEMLaneRing(const IVSHMEMChannelView *view, uint32_t lane)
+{
+    return (uint8_t *) view->channel + view->lanes[lane].offset;
+}
+
+// Aligned offsets keep every message, and so its 64-bit deadline, naturally
+// aligned; misaligned loads fault on Device-mapped memory.
+static inline bool IVSHMEMLaneInfoValid(const IVSHMEMLaneInfo *info, size_t length)
+{
+    return info->size >= 2 * sizeof(IVSHMEMLaneMessage) && (info->size & (info->size - 1)) == 0
+           && info->offset >= sizeof(IVSHMEMChannel) && info->offset <= length
+           && (info->offset & (kIVSHMEMLaneAlignment - 1)) == 0
+           && info->size <= length - info->offset && info->quantum != 0
+           && (info->laneClass == kIVSHMEMLaneLatency || info->laneClass == kIVSHMEMLaneBulk);
+}
+
+/*
+ * Lay the channel out at the start of `base`, one ring per config entry.
+ * Done once by whichever side owns the region, before the peer attaches.
+ */
+static inline bool IVSHMEMChannelFormat(void *base, size_t length, const IVSHMEMLaneConfig *configs,
+                                        uint32_t laneCount, IVSHMEMChannelView *view)
+{
+    IVSHMEMChannel *channel = (IVSHMEMChannel *) base;
+    size_t offset = sizeof(IVSHMEMChannel);
+
+    if (laneCount == 0 || laneCount > kIVSHMEMMaxLanes || length < sizeof(IVSHMEMChannel))
+        return false;
+
+    memset(view, 0, sizeof(*view));
+
+    for (uint32_t i = 0; i < laneCount; i++) {
+        IVSHMEMLaneInfo *info = &view->lanes[i];
+
+        // Offsets are 32-bit in the channel header; refuse layouts past 4 GB.
+        if (offset > UINT32_MAX)
+            return false;
+
+        info->offset    = (uint32_t) offset;
+        info->size      = configs[i].size;
+        info->laneClass = configs[i].laneClass;
+        info->vector    = configs[i].vector;
+        info->quantum   = configs[i].quantum ? configs[i].quantum : kIVSHMEMDefaultQuantum;
+
+        if (!IVSHMEMLaneInfoValid(info, length))
+            return false;
+        offset += info->size;
+    }
+
+    memset(channel, 0, sizeof(IVSHMEMChannel));
+    for (uint32_t i = 0; i < laneCount; i++) {
+        channel->lanes[i].offset    = view->lanes[i].offset;
+        channel->lanes[i].size      = view->lanes[i].size;
+        channel->lanes[i].laneClass = view->lanes[i].laneClass;
+        channel->lanes[i].vector    = view->lanes[i].vector;
+        channel->lanes[i].quantum   = view->lanes[i].quantum;
+    }
+    channel->laneCount = laneCount;
+    __atomic_store_n(&channel->magic, kIVSHMEMChannelMagic, __ATOMIC_RELEASE);
+
+    view->channel   = channel;
+    view->laneCount = laneCount;
+    return true;
+}
+
+// Snapshot and validate the layout the peer formatted. False if it hasn't yet, or if it's bogus.
+static inline bool IVSHMEMChannelAttach(void *base, size_t length, IVSHMEMChannelView *view)
+{
+    IVSHMEMChannel *channel = (IVSHMEMChannel *) base;
+    uint32_t laneCount;
+
+    if (length < sizeof(IVSHMEMChannel)
+        || __atomic_load_n(&channel->magic, __ATOMIC_ACQUIRE) != kIVSHMEMChannelMagic)
+        return false;
+
+    laneCount = __atomic_load_n(&channel->laneCount, __ATOMIC_RELAXED);
+    if (laneCount == 0 || laneCount > kIVSHMEMMaxLanes)
+        return false;
+
+    memset(view, 0, sizeof(*view));
+
+    for (uint32_t i = 0; i < laneCount; i++) {
+        const IVSHMEMLane *lane = &channel->lanes[i];
+        IVSHMEMLaneInfo *info = &view->lanes[i];
+
+        info->offset    = __atomic_load_n(&lane->offset, __ATOMIC_RELAXED);
+        info->size      = __atomic_load_n(&lane->size, __ATOMIC_RELAXED);
+        info->laneClass = __atomic_load_n(&lane->laneClass, __ATOMIC_RELAXED);
+        info->vector    = __atomic_load_n(&lane->vector, __ATOMIC_RELAXED);
+        info->quantum   = __atomic_load_n(&lane->quantum, __ATOMIC_RELAXED);
+
+        if (!IVSHMEMLaneInfoValid(info, length))
+            return false;
+    }
+
+    view->channel   = channel;
+    view->laneCount = laneCount;
+    return true;
+}
+
+// Doorbell vector the producer should ring after sending on `lane`.
+static inline uint32_t IVSHMEMLaneVector(const IVSHMEMChannelView *view, uint32_t lane)
+{
+    return view->lanes[lane].vector;
+}
+
+/*
+ * Producer side. Returns false if the lane doesn't have room; the caller
+ * decides whether to retry, drop or fall back to another lane. Messages
+ * that would straddle the end of the ring are placed at its start instead.
+ * Messages needing more than half the ring are always refused: they could
+ * otherwise find no position that fits, even with the ring empty.
+ */
+static inline bool IVSHMEMLaneSend(const IVSHMEMChannelView *view, uint32_t lane,
+                                   const void *payload, uint32_t length,
+                                   uint64_t deadline, bool stamp)
+{
+    IVSHMEMLane *l;
+    uint32_t size, need, head, tail, pos, skip;
+    IVSHMEMLaneMessage *message;
+
+    if (lane >= view->laneCount)
+        return false;
+
+    l = &view->channel->lanes[lane];
+    size = view->lanes[lane].size;
+    if (length > size / 2 || (need = IVSHMEMLaneMessageSize(length)) > size / 2)
+        return false;
+
+    head = l->head;
+    tail = __atomic_load_n(&l->tail, __ATOMIC_ACQUIRE);
+    pos = head & (size - 1);
+    skip = (size - pos < need) ? size - pos : 0;
+
+    if ((head - tail) + skip + need > size)
+        return false;
+
+    if (skip) {
+        if (skip >= sizeof(IVSHMEMLaneMessage))
+            ((IVSHMEMLaneMessage *) (IVSHMEMLaneRing(view, lane) + pos))->record.length = kIVSHMEMLaneWrap;
+        pos = 0;
+    }
+
+    message = (IVSHMEMLaneMessage *) (IVSHMEMLaneRing(view, lane) + pos);
+    message->deadline = deadline;
+    IVSHMEMRecordWrite(&message->record, l->sequence++, payload, length, stamp);
+
+    __atomic_store_n(&l->head, head + skip + need, __ATOMIC_RELEASE);
+    return true;
+}
+
+/*
+ * Consumer side. Peek fills `slot` with the oldest message in the lane
+ * without consuming it, or returns false if the lane is empty. Every field
+ * the consumer relies on is read once, validated and copied into the slot;
+ * read the payload with IVSHMEMRecordRead(&slot->message->record, slot->length, ...).
+ */
+static inline bool IVSHMEMLanePeek(const IVSHMEMChannelView *view, uint32_t lane, IVSHMEMLaneSlot *slot)
+{
+    IVSHMEMLane *l;
+    uint32_t size, tail, head;
+
+    if (lane >= view->laneCount)
+        return false;
+
+    l = &view->channel->lanes[lane];
+    size = view->lanes[lane].size;
+    tail = l->tail;
+    head = __atomic_load_n(&l->head, __ATOMIC_ACQUIRE);
+
+    // An honest producer only ever publishes aligned heads. Don't follow a
+    // misaligned one, or messages would be read at misaligned positions.
+    if (head & (kIVSHMEMLaneAlignment - 1))
+        return false;
+
+    // More outstanding than the ring holds, or a misaligned tail: head or
+    // tail was scribbled on.
+    if (head - tail > size || (tail & (kIVSHMEMLaneAlignment - 1))) {
+        tail = head;
+        __atomic_store_n(&l->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    // Every step either returns, moves tail to the ring start or ends at head,
+    // so this runs at most twice.
+    while (tail != head) {
+        uint32_t pos = tail & (size - 1);
+        const IVSHMEMLaneMessage *message = (const IVSHMEMLaneMessage *) (IVSHMEMLaneRing(view, lane) + pos);
+        uint32_t length;
+
+        if (size - pos >= sizeof(IVSHMEMLaneMessage)
+            && (length = __atomic_load_n(&message->record.length, __ATOMIC_RELAXED)) != kIVSHMEMLaneWrap) {
+            uint32_t messageSize = IVSHMEMLaneMessageSize(length);
+
+            if (length <= size && messageSize <= size - pos && messageSize <= head - tail) {
+                slot->message  = message;
+                slot->size     = messageSize;
+                slot->length   = length;
+                slot->deadline = __atomic_load_n(&message->deadline, __ATOMIC_RELAXED);
+                return true;
+            }
+        } else if (size - pos <= head - tail) {
+            // The producer skipped the rest of the ring and counted it in head; so do we.
+            tail += size - pos;
+            __atomic_store_n(&l->tail, tail, __ATOMIC_RELEASE);
+            continue;
+        }
+
+        // Malformed message, or a skip the producer never accounted for:
+        // discard the lane's backlog rather than stall on it.
+        tail = head;
+        __atomic_store_n(&l->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    return false;
+}
+
+// Release a message returned by IVSHMEMLanePeek(), by the size validated there.
+static inline void IVSHMEMLaneConsume(const IVSHMEMChannelView *view, uint32_t lane, const IVSHMEMLaneSlot *slot)
+{
+    IVSHMEMLane *l = &view->channel->lanes[lane];
+
+    __atomic_store_n(&l->tail, l->tail + slot->size, __ATOMIC_RELEASE);
+}
+
+/*
+ * Consumer-side scheduler. Private to the consumer, never placed in BAR2.
+ *
+ * Latency lanes are drained first, in lane order. Then any bulk message
+ * whose deadline falls within `urgency` of now is served, earliest deadline
+ * first. Otherwise bulk lanes share the remaining bandwidth by deficit
+ * round-robin. Deadline-driven picks are charged to their lane's deficit,
+ * and a lane more than one quantum in debt loses the deadline fast path
+ * until round-robin has paid it back, so deadlines can't be used to starve
+ * the other bulk lanes.
+ */
+typedef struct IVSHMEMScheduler {
+    IVSHMEMChannelView  view;                           // snapshot, the peer can't change it under us
+    uint64_t            urgency;
+    uint32_t            cursor;                         // bulk lane DRR is visiting
+    bool                granted;                        // cursor lane already got its quantum this visit
+    int64_t             deficit[kIVSHMEMMaxLanes];
+} IVSHMEMScheduler;
+
+static inline void IVSHMEMSchedulerInit(IVSHMEMScheduler *sched, const IVSHMEMChannelView *view, uint64_t urgency)
+{
+    memset(sched, 0, sizeof(*sched));
+    sched->view    = *view;
+    sched->urgency = urgency;
+}
+
+// Pick the next message to process. `now` must use the same timebase as
+// the deadlines. The message stays in its lane until IVSHMEMSchedulerConsume().
+static inline bool IVSHMEMSchedulerNext(IVSHMEMScheduler *sched, uint64_t now, uint32_t *laneOut, IVSHMEMLaneSlot *slot)
+{
+    const IVSHMEMChannelView *view = &sched->view;
+    uint32_t laneCount = view->laneCount;
+    IVSHMEMLaneSlot heads[kIVSHMEMMaxLanes];
+    bool ready[kIVSHMEMMaxLanes];
+    int urgent = -1;
+    bool pending = false;
+
+    for (uint32_t i = 0; i < laneCount; i++) {
+        if (view->lanes[i].laneClass == kIVSHMEMLaneLatency && IVSHMEMLanePeek(view, i, slot)) {
+            *laneOut = i;
+            return true;
+        }
+    }
+
+    for (uint32_t i = 0; i < laneCount; i++) {
+        ready[i] = view->lanes[i].laneClass == kIVSHMEMLaneBulk && IVSHMEMLanePeek(view, i, &heads[i]);
+        if (!ready[i])
+            continue;
+
+        pending = true;
+        if (heads[i].deadline && heads[i].deadline <= now + sched->urgency
+            && sched->deficit[i] > -(int64_t) view->lanes[i].quantum
+            && (urgent < 0 || heads[i].deadline < heads[urgent].deadline))
+            urgent = (int) i;
+    }
+
+    if (urgent >= 0) {
+        *laneOut = (uint32_t) urgent;
+        *slot = heads[urgent];
+        return true;
+    }
+
+    if (!pending)
+        return false;
+
+    for (uint32_t visits = 0;; visits++) {
+        uint32_t i = sched->cursor;
+
+        /*
+         * A full round without a pick leaves every ready lane short of its
+         * head message. Rather than spin one round per quantum (which a
+         * peer-supplied quantum of 1 makes one round per byte), credit all
+         * ready lanes with the rounds it takes until the first of them can
+         * afford its message; the next round then picks exactly as looping would.
+         */
+        if (visits == laneCount) {
+            int64_t rounds = INT64_MAX;
+
+            for (uint32_t j = 0; j < laneCount; j++) {
+                if (ready[j]) {
+                    int64_t quantum = view->lanes[j].quantum;
+                    int64_t needed = (heads[j].size - sched->deficit[j] + quantum - 1) / quantum;
+
+                    if (needed < rounds)
+                        rounds = needed;
+                }
+            }
+            for (uint32_t j = 0; j < laneCount; j++) {
+                if (ready[j])
+                    sched->deficit[j] += (rounds - 1) * (int64_t) view->lanes[j].quantum;
+            }
+        }
+
+        if (ready[i]) {
+            if (!sched->granted) {
+                sched->deficit[i] += view->lanes[i].quantum;
+                sched->granted = true;
+            }
+            if (heads[i].size <= sched->deficit[i]) {
+                *laneOut = i;
+                *slot = heads[i];
+                return true;
+            }
+        } else if (sched->deficit[i] > 0) {
+            sched->deficit[i] = 0;
+        }
+
+        sched->granted = false;
+        sched->cursor = (i + 1) % laneCount;
+    }
+}
+
+static inline void IVSHMEMSchedulerConsume(IVSHMEMScheduler *sched, uint32_t lane, const IVSHMEMLaneSlot *slot)
+{
+    if (sched->view.lanes[lane].laneClass == kIVSHMEMLaneBulk)
+        sched->deficit[lane] -= slot->size;
+
+    IVSHMEMLaneConsume(&sched->view, lane, slot);
+}
+
+#endif /* IVSHMEMLanes_hpp */
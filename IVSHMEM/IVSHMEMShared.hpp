@@ -9,10 +9,12 @@
 #ifndef IVSHMEMShared_hpp
 #define IVSHMEMShared_hpp
 
+#include "IVSHMEMChecksum.hpp"
+
 enum {
     kSampleMethod1 = 0,
     kSampleMethod2 = 1,
-    kSampleMethod3 = 2,
+    kSampleMethod3 = 2,     // ring a doorbell: scalar input { peer, vector }
     kSampleNumMethods
 };
 
@@ -25,8 +27,9 @@ enum {
 enum {
     // KVM Inter-VM shared memory device register offsets
     IntrMask        = 0x00,     // Interrupt Mask
-    IntrStatus      = 0x10,     // Interrupt Status
-    Doorbell        = 0x20,     // Doorbell
+    IntrStatus      = 0x04,     // Interrupt Status
+    IVPosition      = 0x08,     // This peer's ID
+    Doorbell        = 0x0C,     // Doorbell: peer << 16 | vector
     ShmOK = 1               // Everything is OK
 };
 
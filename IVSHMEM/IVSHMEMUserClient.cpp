@@ -69,6 +69,17 @@ bool IVSHMEMDeviceUserClient::start(IOService *provider)
     assert(OSDynamicCast(IVSHMEMDevice, provider));
     fDriver = (IVSHMEMDevice*) provider;
     
+    /*
+     * Open the provider for the lifetime of this user client. externalMethod
+     * refuses to run unless we hold it open, and the provider can't be stopped
+     * (releasing its register mapping) until we close it again in stop().
+     */
+    
+    if (!fDriver->open(this)) {
+        fDriver = NULL;
+        return false;
+    }
+    
     /*
      * Set up some memory to be shared between this user client instance and its
      * client process. The client will call in to map this memory, and I/O Kit
@@ -81,8 +92,10 @@ bool IVSHMEMDeviceUserClient::start(IOService *provider)
     
     // TODO: replace this sizeof with a method to get the size of the actual IVSHMEM BAR2 region
     fClientSharedMemory = IOBufferMemoryDescriptor::withOptions(kIOMemoryKernelUserShared, sizeof(DriverSharedMemory));
-    if (!fClientSharedMemory)
+    if (!fClientSharedMemory) {
+        fDriver->close(this);
         return false;
+    }
 
     fClientShared = (DriverSharedMemory *) fClientSharedMemory->getBytesNoCopy();
     
@@ -129,6 +142,9 @@ void IVSHMEMDeviceUserClient::stop(IOService *provider)
         fClientSharedMemory = 0;
     }
     
+    if (fDriver && fDriver->isOpen(this))
+        fDriver->close(this);
+    
     super::stop(provider);
 }
 
@@ -140,22 +156,19 @@ IOReturn IVSHMEMDeviceUserClient::externalMethod(uint32_t selector,
                                                  void *reference)
 {
     
-    IOReturn    result;
-    
     if (fDriver == NULL || isInactive()) {
         // Return an error if we don't have a provider. This could happen if the user process
         // called either method without calling IOServiceOpen first. Or, the user client could be
         // in the process of being terminated and is thus inactive.
-        result = kIOReturnNotAttached;
+        return kIOReturnNotAttached;
     }
     else if (!fDriver->isOpen(this)) {
-        // Return an error if we do not have the driver open. This could happen if the user process
-        // did not call openUserClient before calling this function.
-        result = kIOReturnNotOpen;
+        // Return an error if we do not have the driver open. This could happen if the user client
+        // failed to open its provider in start().
+        return kIOReturnNotOpen;
     }
     
     IOReturn err;
-    IOLog("The Leopard and later way to route external methods\n");
     switch (selector)
     {
         case kSampleMethod1:
@@ -164,6 +177,12 @@ IOReturn IVSHMEMDeviceUserClient::externalMethod(uint32_t selector,
                           arguments->structureInputSize, (IOByteCount *) &arguments->structureOutputSize );
             break;
             
+        case kSampleMethod3:
+            // Latency-sensitive signalling path: no logging.
+            if (arguments->scalarInputCount != 2)
+                return kIOReturnBadArgument;
+            return ringDoorbell(arguments->scalarInput[0], arguments->scalarInput[1]);
+            
 //        case kSampleMethod2:
 //            err = method2( (SampleStructForMethod2 *) arguments->structureInput,
 //                          (SampleResultsForMethod2 *)  arguments->structureOutput,
@@ -220,6 +239,20 @@ IOReturn IVSHMEMDeviceUserClient::method1(UInt32 *dataIn,
     return( ret );
 }
 
+/*
+ * Signal a priority lane: ring the doorbell of `peer` on `vector`
+ * (see IVSHMEMLaneVector() in IVSHMEMLanes.hpp).
+ */
+IOReturn IVSHMEMDeviceUserClient::ringDoorbell(uint64_t peer, uint64_t vector)
+{
+    if (fDriver == NULL || isInactive())
+        return kIOReturnNotAttached;
+    if (peer > 0xFFFF || vector > 0xFFFF)
+        return kIOReturnBadArgument;
+    
+    return fDriver->ringDoorbell((UInt16) peer, (UInt16) vector);
+}
+
 /*
  * Shared memory support. Supply a IOMemoryDescriptor instance to describe
  * each of the kinds of shared memory available to be mapped into the client
@@ -43,6 +43,7 @@ public:
     
     // External methods
     virtual IOReturn method1(UInt32 *dataIn, UInt32 *dataOut, IOByteCount inputCount, IOByteCount *outputCount);
+    virtual IOReturn ringDoorbell(uint64_t peer, uint64_t vector);
 };
 
 #endif /* IVSHMEMUserClient_hpp */
@@ -0,0 +1,180 @@
+//
+//  checksum_test.c
+//  IVSHMEM
+//
+//  Known-answer and record tests for IVSHMEMChecksum.hpp.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "IVSHMEMChecksum.hpp"
+
+static int failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+// RFC 3720 (iSCSI) appendix B.4 vectors plus the usual "123456789".
+static void TestKnownAnswers(void)
+{
+    uint8_t zeros[32], ones[32], up[32], down[32], copy[32];
+
+    for (int i = 0; i < 32; i++) {
+        zeros[i] = 0;
+        ones[i]  = 0xFF;
+        up[i]    = (uint8_t) i;
+        down[i]  = (uint8_t) (31 - i);
+    }
+
+    CHECK(IVSHMEMCRC32C("", 0) == 0x00000000);
+    CHECK(IVSHMEMCRC32C("123456789", 9) == 0xE3069283);
+    CHECK(IVSHMEMCRC32C(zeros, 32) == 0x8A9136AA);
+    CHECK(IVSHMEMCRC32C(ones, 32) == 0x62A8AB43);
+    CHECK(IVSHMEMCRC32C(up, 32) == 0x46DD794E);
+    CHECK(IVSHMEMCRC32C(down, 32) == 0x113FDB5C);
+
+    CHECK(~IVSHMEMCRC32CUpdateSoftware(kIVSHMEMCRC32CInit, "123456789", 9) == 0xE3069283);
+    CHECK(IVSHMEMCopyWithCRC32C(copy, up, 32) == 0x46DD794E);
+    CHECK(memcmp(copy, up, 32) == 0);
+}
+
+// x^n mod P by square-and-multiply; x^0 is the top bit in reflected form.
+static uint32_t PowerOfX(uint64_t n)
+{
+    uint32_t result = 1u << 31, x = 1u << 30;
+
+    for (; n; n >>= 1) {
+        if (n & 1)
+            result = IVSHMEMCRC32CMultiply(result, x);
+        x = IVSHMEMCRC32CMultiply(x, x);
+    }
+    return result;
+}
+
+static void TestStrideShift(void)
+{
+    static const struct { uint32_t stride, shift; } tiers[3] = {
+        [kIVSHMEMCRC32CTierLarge]  = { kIVSHMEMCRC32CStrideLarge, kIVSHMEMCRC32CShiftLarge },
+        [kIVSHMEMCRC32CTierMedium] = { kIVSHMEMCRC32CStrideMedium, kIVSHMEMCRC32CShiftMedium },
+        [kIVSHMEMCRC32CTierSmall]  = { kIVSHMEMCRC32CStrideSmall, kIVSHMEMCRC32CShiftSmall },
+    };
+
+    for (uint32_t tier = 0; tier < 3; tier++) {
+        CHECK(PowerOfX(8 * tiers[tier].stride) == tiers[tier].shift);
+        for (uint32_t k = 0; k < 8; k++)
+            for (uint32_t n = 0; n < 16; n++)
+                CHECK(kIVSHMEMCRC32CShiftTables[tier][k][n] == IVSHMEMCRC32CMultiply(tiers[tier].shift, n << (4 * k)));
+        CHECK(IVSHMEMCRC32CShift(tier, 0x12345678) == IVSHMEMCRC32CMultiply(tiers[tier].shift, 0x12345678));
+    }
+}
+
+// The dispatched kernels must agree with the software ones at every length
+// and alignment, including lengths at and around every block tier.
+static void TestKernelsAgree(void)
+{
+    static uint8_t src[8 * kIVSHMEMCRC32CStrideLarge], dst[8 * kIVSHMEMCRC32CStrideLarge];
+    static const size_t longLengths[] = {
+        3 * kIVSHMEMCRC32CStrideMedium - 1, 3 * kIVSHMEMCRC32CStrideMedium + 3 * kIVSHMEMCRC32CStrideSmall,
+        3 * kIVSHMEMCRC32CStrideLarge - 1, 3 * kIVSHMEMCRC32CStrideLarge, 3 * kIVSHMEMCRC32CStrideLarge + 9,
+        6 * kIVSHMEMCRC32CStrideLarge + 3 * kIVSHMEMCRC32CStrideMedium + 3 * kIVSHMEMCRC32CStrideSmall + 5,
+        8 * kIVSHMEMCRC32CStrideLarge - 8,
+    };
+
+    for (size_t i = 0; i < sizeof(src); i++)
+        src[i] = (uint8_t) (i * 131 + 7);
+
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t length = 0; length + offset <= 520; length += 13) {
+            uint32_t expected = ~IVSHMEMCRC32CUpdateSoftware(kIVSHMEMCRC32CInit, src + offset, length);
+
+            memset(dst, 0, sizeof(dst));
+            CHECK(IVSHMEMCRC32C(src + offset, length) == expected);
+            CHECK(IVSHMEMCopyWithCRC32C(dst + 7 - offset, src + offset, length) == expected);
+            CHECK(memcmp(dst + 7 - offset, src + offset, length) == 0);
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(longLengths) / sizeof(longLengths[0]); i++) {
+        size_t length = longLengths[i];
+        uint32_t expected = ~IVSHMEMCRC32CUpdateSoftware(kIVSHMEMCRC32CInit, src + 3, length);
+
+        // Also exercise the stitching in the software kernels against a plain byte loop.
+        uint32_t bytewise = kIVSHMEMCRC32CInit;
+        for (size_t j = 0; j < length; j++)
+            bytewise = IVSHMEMCRC32CByteSoftware(bytewise, src[3 + j]);
+        CHECK(~bytewise == expected);
+
+        memset(dst, 0, sizeof(dst));
+        CHECK(IVSHMEMCRC32C(src + 3, length) == expected);
+        CHECK(IVSHMEMCopyWithCRC32C(dst + 5, src + 3, length) == expected);
+        CHECK(memcmp(dst + 5, src + 3, length) == 0);
+    }
+}
+
+static void TestRecords(void)
+{
+    static const char payload[] = "some data crossing the VM boundary";
+    uint32_t length = sizeof(payload);
+    uint64_t storage[16];
+    IVSHMEMRecordHeader *record = (IVSHMEMRecordHeader *) storage;
+    char out[sizeof(payload)];
+    uint32_t outLength = 0;
+
+    IVSHMEMRecordWrite(record, 8, payload, length, true);
+    CHECK(IVSHMEMRecordVerify(record, length, true));
+    CHECK(IVSHMEMRecordRead(record, length, out, sizeof(out), &outLength,
+                            kIVSHMEMVerifyPayload | kIVSHMEMVerifyRequireStamp));
+    CHECK(outLength == length && memcmp(out, payload, length) == 0);
+
+    // Lengths beyond what the caller can vouch for are refused outright.
+    CHECK(!IVSHMEMRecordVerify(record, length - 1, false));
+    CHECK(!IVSHMEMRecordRead(record, length - 1, out, sizeof(out), &outLength, 0));
+    CHECK(!IVSHMEMRecordRead(record, length, out, sizeof(out) - 1, &outLength, 0));
+
+    // Every single-bit flip in the stamped header or payload is caught.
+    for (size_t bit = 0; bit < (sizeof(*record) + length) * 8; bit++) {
+        uint8_t *bytes = (uint8_t *) record;
+
+        bytes[bit / 8] ^= (uint8_t) (1u << (bit % 8));
+        CHECK(!IVSHMEMRecordVerify(record, sizeof(storage) - sizeof(*record), true));
+        bytes[bit / 8] ^= (uint8_t) (1u << (bit % 8));
+    }
+    CHECK(IVSHMEMRecordVerify(record, length, true));
+
+    // Clearing the stamp only passes if the consumer doesn't require one.
+    record->flags = 0;
+    CHECK(IVSHMEMRecordVerify(record, length, false));
+    CHECK(!IVSHMEMRecordVerify(record, length, true));
+    CHECK(!IVSHMEMRecordRead(record, length, out, sizeof(out), &outLength, kIVSHMEMVerifyRequireStamp));
+
+    IVSHMEMRecordWrite(record, 3, payload, length, false);
+    CHECK(IVSHMEMRecordVerify(record, length, false));
+    CHECK(record->crc == 0 && record->flags == 0);
+
+    CHECK(IVSHMEMRecordSampled(record, 0));
+    CHECK(!IVSHMEMRecordSampled(record, 1));
+    record->sequence = 0x80000000u;
+    CHECK(IVSHMEMRecordSampled(record, 31));
+    CHECK(IVSHMEMRecordSampled(record, 64));    // clamped to 31
+}
+
+int main(void)
+{
+    TestKnownAnswers();
+    TestStrideShift();
+    TestKernelsAgree();
+    TestRecords();
+
+    if (failures) {
+        fprintf(stderr, "checksum_test: %d failure(s)\n", failures);
+        return EXIT_FAILURE;
+    }
+
+    printf("checksum_test: ok\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,389 @@
+//
+//  lanes_test.c
+//  IVSHMEM
+//
+//  Ring, scheduler and peer-tampering tests for IVSHMEMLanes.hpp.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "IVSHMEMLanes.hpp"
+
+#define kRegionSize     (1 << 20)
+
+static int failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+static void *region;
+
+static bool Format(IVSHMEMChannelView *view, const IVSHMEMLaneConfig *configs, uint32_t laneCount)
+{
+    memset(region, 0xA5, kRegionSize);
+    return IVSHMEMChannelFormat(region, kRegionSize, configs, laneCount, view);
+}
+
+static void TestAttach(void)
+{
+    IVSHMEMLaneConfig configs[2] = {
+        { kIVSHMEMLaneLatency, 1, 4096, 0 },
+        { kIVSHMEMLaneBulk, 0, 65536, 1000 },
+    };
+    IVSHMEMLaneConfig bad = { kIVSHMEMLaneBulk, 0, 3000, 0 };
+    IVSHMEMChannel *channel = (IVSHMEMChannel *) region;
+    IVSHMEMChannelView view, attached;
+
+    CHECK(!Format(&view, &bad, 1));
+    CHECK(!IVSHMEMChannelAttach(region, kRegionSize, &attached));
+
+    CHECK(Format(&view, configs, 2));
+    CHECK(IVSHMEMChannelAttach(region, kRegionSize, &attached));
+    CHECK(memcmp(&view, &attached, sizeof(view)) == 0);
+    CHECK(view.lanes[0].quantum == kIVSHMEMDefaultQuantum);
+    CHECK(IVSHMEMLaneVector(&attached, 0) == 1);
+
+    channel->laneCount = kIVSHMEMMaxLanes + 1;
+    CHECK(!IVSHMEMChannelAttach(region, kRegionSize, &attached));
+    channel->laneCount = 2;
+    channel->lanes[1].offset = kRegionSize - 1024;
+    CHECK(!IVSHMEMChannelAttach(region, kRegionSize, &attached));
+    channel->lanes[1].offset = view.lanes[1].offset + 4;
+    CHECK(!IVSHMEMChannelAttach(region, kRegionSize, &attached));
+    channel->lanes[1].offset = view.lanes[1].offset;
+    channel->lanes[1].quantum = 0;
+    CHECK(!IVSHMEMChannelAttach(region, kRegionSize, &attached));
+    channel->lanes[1].quantum = view.lanes[1].quantum;
+    channel->lanes[1].laneClass = 7;
+    CHECK(!IVSHMEMChannelAttach(region, kRegionSize, &attached));
+    channel->lanes[1].laneClass = view.lanes[1].laneClass;
+    CHECK(IVSHMEMChannelAttach(region, kRegionSize, &attached));
+}
+
+// Ring offsets are 32-bit; a layout reaching past 4 GB must not wrap around.
+static void TestLargeLayout(void)
+{
+    IVSHMEMLaneConfig configs[3] = {
+        { kIVSHMEMLaneBulk, 0, 1u << 31, 0 },
+        { kIVSHMEMLaneBulk, 0, 1u << 31, 0 },
+        { kIVSHMEMLaneBulk, 0, 4096, 0 },
+    };
+    IVSHMEMChannelView view;
+
+    if (sizeof(size_t) < 8)
+        return;
+
+    // Validation fails before anything is written, so the small region is safe here.
+    memset(region, 0, sizeof(IVSHMEMChannel));
+    CHECK(!IVSHMEMChannelFormat(region, (size_t) 1 << 33, configs, 3, &view));
+    CHECK(((IVSHMEMChannel *) region)->magic != kIVSHMEMChannelMagic);
+}
+
+// Drain a lane, checking every payload is intact and arrives in order.
+static uint32_t Drain(const IVSHMEMChannelView *view, uint32_t lane, uint32_t expected)
+{
+    IVSHMEMLaneSlot slot;
+    uint8_t out[512];
+    uint32_t outLength = 0;
+
+    while (IVSHMEMLanePeek(view, lane, &slot)) {
+        CHECK(IVSHMEMRecordRead(&slot.message->record, slot.length, out, sizeof(out), &outLength,
+                                kIVSHMEMVerifyPayload | kIVSHMEMVerifyRequireStamp));
+        CHECK(outLength == (expected * 37) % 489);
+        CHECK(slot.message->record.sequence == expected);
+        for (uint32_t i = 0; i < outLength; i++)
+            CHECK(out[i] == (uint8_t) expected);
+        IVSHMEMLaneConsume(view, lane, &slot);
+        expected++;
+    }
+
+    return expected;
+}
+
+// Varying sizes force every kind of wrap: explicit markers and the implicit
+// skip when fewer than a header's worth of bytes remain.
+static void TestRingWrap(void)
+{
+    IVSHMEMLaneConfig config = { kIVSHMEMLaneBulk, 0, 1024, 0 };
+    IVSHMEMChannelView view;
+    uint8_t payload[512];
+    uint32_t received = 0;
+
+    CHECK(Format(&view, &config, 1));
+    view.channel->lanes[0].sequence = 0;
+
+    for (uint32_t i = 0; i < 20000; i++) {
+        uint32_t length = (i * 37) % 489;
+
+        memset(payload, (uint8_t) i, length);
+        if (!IVSHMEMLaneSend(&view, 0, payload, length, 0, true)) {
+            received = Drain(&view, 0, received);
+            CHECK(IVSHMEMLaneSend(&view, 0, payload, length, 0, true));
+        }
+        if (i % 3 != 0)
+            received = Drain(&view, 0, received);
+    }
+
+    CHECK(Drain(&view, 0, received) == 20000);
+}
+
+static void TestOversizedSend(void)
+{
+    IVSHMEMLaneConfig config = { kIVSHMEMLaneBulk, 0, 256, 0 };
+    IVSHMEMChannelView view;
+    IVSHMEMLaneSlot slot;
+    uint8_t payload[256] = { 0 };
+    uint32_t largest = 128 - sizeof(IVSHMEMLaneMessage);
+
+    CHECK(Format(&view, &config, 1));
+    CHECK(!IVSHMEMLaneSend(&view, 0, payload, 200, 0, false));
+    CHECK(!IVSHMEMLaneSend(&view, 0, payload, largest + 1, 0, false));
+    CHECK(!IVSHMEMLaneSend(&view, 3, payload, 8, 0, false));
+
+    // Anything accepted must fit into an empty ring wherever head happens to be.
+    for (uint32_t pos = 0; pos < 256; pos += 8) {
+        CHECK(Format(&view, &config, 1));
+        view.channel->lanes[0].head = view.channel->lanes[0].tail = pos;
+        CHECK(IVSHMEMLaneSend(&view, 0, payload, largest, 0, false));
+        CHECK(IVSHMEMLanePeek(&view, 0, &slot) && slot.length == largest);
+    }
+}
+
+static const IVSHMEMLaneConfig schedulerConfigs[3] = {
+    { kIVSHMEMLaneLatency, 1, 4096, 0 },
+    { kIVSHMEMLaneBulk, 0, 65536, 1000 },
+    { kIVSHMEMLaneBulk, 0, 65536, 3000 },
+};
+
+static void Fill(const IVSHMEMChannelView *view, uint32_t lane, uint32_t length, uint64_t deadline)
+{
+    static const uint8_t payload[4096];
+
+    while (IVSHMEMLaneSend(view, lane, payload, length, deadline, false))
+        ;
+}
+
+static void TestLatencyFirst(void)
+{
+    IVSHMEMChannelView view;
+    IVSHMEMScheduler sched;
+    IVSHMEMLaneSlot slot;
+    uint32_t lane;
+
+    CHECK(Format(&view, schedulerConfigs, 3));
+    IVSHMEMSchedulerInit(&sched, &view, 0);
+    Fill(&view, 1, 1000, 0);
+    Fill(&view, 2, 1000, 0);
+    CHECK(IVSHMEMLaneSend(&view, 0, "cursor", 6, 0, false));
+
+    CHECK(IVSHMEMSchedulerNext(&sched, 0, &lane, &slot) && lane == 0 && slot.length == 6);
+    IVSHMEMSchedulerConsume(&sched, lane, &slot);
+    CHECK(IVSHMEMSchedulerNext(&sched, 0, &lane, &slot) && lane != 0);
+}
+
+// Quanta of 1000 and 3000 bytes should split bulk bandwidth 1:3.
+static void TestDeficitRoundRobin(void)
+{
+    IVSHMEMChannelView view;
+    IVSHMEMScheduler sched;
+    uint64_t bytes[3] = { 0 };
+
+    CHECK(Format(&view, schedulerConfigs, 3));
+    IVSHMEMSchedulerInit(&sched, &view, 0);
+
+    for (int i = 0; i < 20000; i++) {
+        IVSHMEMLaneSlot slot;
+        uint32_t lane;
+
+        Fill(&view, 1, 200, 0);
+        Fill(&view, 2, 700, 0);
+        CHECK(IVSHMEMSchedulerNext(&sched, 0, &lane, &slot));
+        bytes[lane] += slot.size;
+        IVSHMEMSchedulerConsume(&sched, lane, &slot);
+    }
+
+    CHECK(bytes[0] == 0);
+    CHECK(bytes[2] > 2.8 * bytes[1] && bytes[2] < 3.2 * bytes[1]);
+}
+
+static void TestDeadlines(void)
+{
+    IVSHMEMChannelView view;
+    IVSHMEMScheduler sched;
+    IVSHMEMLaneSlot slot;
+    uint32_t lane;
+    uint8_t payload[64] = { 0 };
+
+    CHECK(Format(&view, schedulerConfigs, 3));
+    IVSHMEMSchedulerInit(&sched, &view, 10);
+
+    // Outside the urgency window deadlines don't matter: DRR starts at lane 1.
+    CHECK(IVSHMEMLaneSend(&view, 1, payload, 64, 0, false));
+    CHECK(IVSHMEMLaneSend(&view, 2, payload, 64, 500, false));
+    CHECK(IVSHMEMSchedulerNext(&sched, 0, &lane, &slot) && lane == 1);
+    IVSHMEMSchedulerConsume(&sched, lane, &slot);
+
+    // Inside it, the earliest deadline wins.
+    CHECK(IVSHMEMSchedulerNext(&sched, 495, &lane, &slot) && lane == 2 && slot.deadline == 500);
+    IVSHMEMSchedulerConsume(&sched, lane, &slot);
+    CHECK(IVSHMEMLaneSend(&view, 2, payload, 64, 30, false));
+    CHECK(IVSHMEMLaneSend(&view, 1, payload, 64, 32, false));
+    CHECK(IVSHMEMSchedulerNext(&sched, 25, &lane, &slot) && lane == 2 && slot.deadline == 30);
+    IVSHMEMSchedulerConsume(&sched, lane, &slot);
+    CHECK(IVSHMEMSchedulerNext(&sched, 25, &lane, &slot) && lane == 1 && slot.deadline == 32);
+}
+
+// A lane whose messages are all urgent must not starve the other bulk lanes.
+static void TestDeadlineStarvation(void)
+{
+    IVSHMEMLaneConfig configs[2] = {
+        { kIVSHMEMLaneBulk, 0, 65536, 64 },
+        { kIVSHMEMLaneBulk, 0, 65536, 64 },
+    };
+    IVSHMEMChannelView view;
+    IVSHMEMScheduler sched;
+    int picks[2] = { 0 };
+
+    CHECK(Format(&view, configs, 2));
+    IVSHMEMSchedulerInit(&sched, &view, 10);
+
+    for (int i = 0; i < 1000; i++) {
+        IVSHMEMLaneSlot slot;
+        uint32_t lane;
+
+        Fill(&view, 0, 8, 5);
+        Fill(&view, 1, 8, 0);
+        CHECK(IVSHMEMSchedulerNext(&sched, 0, &lane, &slot));
+        picks[lane]++;
+        IVSHMEMSchedulerConsume(&sched, lane, &slot);
+    }
+
+    CHECK(picks[0] >= 400 && picks[1] >= 400);
+    CHECK(sched.deficit[0] > -2 * 64);
+}
+
+// The peer owns BAR2 and may rewrite anything in it at any time.
+static void TestPeerTampering(void)
+{
+    IVSHMEMChannelView view;
+    IVSHMEMScheduler sched;
+    IVSHMEMLaneSlot slot;
+    IVSHMEMChannel *channel = (IVSHMEMChannel *) region;
+    IVSHMEMLaneMessage *message;
+    uint32_t lane, tail;
+    uint8_t payload[64] = { 0 };
+
+    CHECK(Format(&view, schedulerConfigs, 3));
+    IVSHMEMSchedulerInit(&sched, &view, 0);
+    CHECK(IVSHMEMLaneSend(&view, 1, payload, 64, 0, false));
+    CHECK(IVSHMEMLaneSend(&view, 1, payload, 64, 0, false));
+
+    // The scheduler works from its snapshot of the layout.
+    channel->laneCount = 0xFFFFFFFF;
+    channel->lanes[1].size = 7;
+    channel->lanes[1].laneClass = kIVSHMEMLaneLatency;
+    CHECK(IVSHMEMSchedulerNext(&sched, 0, &lane, &slot) && lane == 1);
+
+    // Consume advances by the size validated at peek, whatever the record says now.
+    tail = channel->lanes[1].tail;
+    message = (IVSHMEMLaneMessage *) slot.message;
+    message->record.length = 60000;
+    IVSHMEMSchedulerConsume(&sched, lane, &slot);
+    CHECK(channel->lanes[1].tail == tail + IVSHMEMLaneMessageSize(64));
+
+    // A malformed length discards the backlog instead of reading past the ring.
+    CHECK(IVSHMEMLanePeek(&sched.view, 1, &slot));
+    ((IVSHMEMLaneMessage *) slot.message)->record.length = 70000;
+    CHECK(!IVSHMEMLanePeek(&sched.view, 1, &slot));
+    CHECK(channel->lanes[1].tail == channel->lanes[1].head);
+
+    // A wrap marker whose skip was never counted in head must not spin the consumer.
+    CHECK(Format(&view, schedulerConfigs, 3));
+    message = (IVSHMEMLaneMessage *) IVSHMEMLaneRing(&view, 0);
+    message->record.length = kIVSHMEMLaneWrap;
+    channel->lanes[0].head = 8;
+    CHECK(!IVSHMEMLanePeek(&view, 0, &slot));
+    CHECK(channel->lanes[0].tail == 8);
+
+    // Nor may a head more than a ring's worth ahead of tail.
+    channel->lanes[0].head = 8 + 4096 + 8;
+    CHECK(!IVSHMEMLanePeek(&view, 0, &slot));
+    CHECK(channel->lanes[0].tail == 8 + 4096 + 8);
+
+    // A misaligned head is never followed; a misaligned tail is reset to head.
+    CHECK(Format(&view, schedulerConfigs, 3));
+    channel->lanes[0].head = 4;
+    CHECK(!IVSHMEMLanePeek(&view, 0, &slot));
+    CHECK(channel->lanes[0].tail == 0);
+    channel->lanes[0].head = 0;
+    CHECK(IVSHMEMLaneSend(&view, 0, payload, 8, 0, false));
+    channel->lanes[0].tail = 4;
+    CHECK(!IVSHMEMLanePeek(&view, 0, &slot));
+    CHECK(channel->lanes[0].tail == channel->lanes[0].head);
+
+    // A zeroed scheduler has no lanes and never picks anything.
+    memset(&sched, 0, sizeof(sched));
+    CHECK(!IVSHMEMSchedulerNext(&sched, 0, &lane, &slot));
+}
+
+// A tiny quantum must not make the scheduler loop once per byte, and must
+// still split bandwidth in proportion to the quanta.
+static void TestTinyQuantum(void)
+{
+    IVSHMEMLaneConfig configs[2] = {
+        { kIVSHMEMLaneBulk, 0, 65536, 1 },
+        { kIVSHMEMLaneBulk, 0, 65536, 3 },
+    };
+    IVSHMEMChannelView view;
+    IVSHMEMScheduler sched;
+    uint64_t bytes[2] = { 0 };
+
+    CHECK(Format(&view, configs, 2));
+    IVSHMEMSchedulerInit(&sched, &view, 0);
+
+    for (int i = 0; i < 4000; i++) {
+        IVSHMEMLaneSlot slot;
+        uint32_t lane;
+
+        Fill(&view, 0, 4000, 0);
+        Fill(&view, 1, 4000, 0);
+        CHECK(IVSHMEMSchedulerNext(&sched, 0, &lane, &slot));
+        bytes[lane] += slot.size;
+        IVSHMEMSchedulerConsume(&sched, lane, &slot);
+    }
+
+    CHECK(bytes[1] > 2.8 * bytes[0] && bytes[1] < 3.2 * bytes[0]);
+}
+
+int main(void)
+{
+    region = aligned_alloc(64, kRegionSize);
+    if (!region)
+        return EXIT_FAILURE;
+
+    TestAttach();
+    TestLargeLayout();
+    TestRingWrap();
+    TestOversizedSend();
+    TestLatencyFirst();
+    TestDeficitRoundRobin();
+    TestDeadlines();
+    TestDeadlineStarvation();
+    TestTinyQuantum();
+    TestPeerTampering();
+
+    free(region);
+
+    if (failures) {
+        fprintf(stderr, "lanes_test: %d failure(s)\n", failures);
+        return EXIT_FAILURE;
+    }
+
+    printf("lanes_test: ok\n");
+    return EXIT_SUCCESS;
+}